@@ -6,28 +6,124 @@
 
 #include <algorithm>
 #include <cctype>
-#include <iostream>
-#include <sstream>
-#include <deque>
-#include <set>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define ARGS_POSIX
+    #include <cerrno>
+    #include <cstdint>
+    #include <unistd.h>
+#endif
+
+// Defining ARGS_LEAN also compiles out batch mode, server mode, and LiveArgs,
+// along with the threading, socket, and file-watching code they depend on.
+#ifndef ARGS_LEAN
+    #include <atomic>
+    #include <condition_variable>
+    #include <iostream>
+    #include <mutex>
+    #include <thread>
+
+    #ifdef ARGS_POSIX
+        #include <signal.h>
+        #include <sys/socket.h>
+        #include <sys/stat.h>
+        #include <sys/un.h>
+        #include <sys/wait.h>
+        #include <poll.h>
+        extern char **environ;
+
+        // Suppress SIGPIPE on socket writes. Platforms without MSG_NOSIGNAL
+        // use the SO_NOSIGPIPE socket option instead.
+        #ifdef MSG_NOSIGNAL
+            #define ARGS_MSG_NOSIGNAL MSG_NOSIGNAL
+        #else
+            #define ARGS_MSG_NOSIGNAL 0
+        #endif
+    #endif
+
+    #ifdef __linux__
+        #include <sys/inotify.h>
+    #endif
+#endif
 
 using namespace std;
 using namespace args;
 
 
+// -----------------------------------------------------------------------------
+// Output.
+// -----------------------------------------------------------------------------
+
+
+// Defining ARGS_LEAN builds the library without <iostream>, avoiding its static
+// initialization and code size for tiny, frequently-run tools. Output is then
+// assembled in a string and written to the file descriptor with write(2).
+
+
+#ifdef ARGS_POSIX
+static bool writeAll(int fd, void const* buffer, size_t size) {
+    char const* ptr = static_cast<char const*>(buffer);
+    while (size > 0) {
+        ssize_t n = write(fd, ptr, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+#endif
+
+
+// Write text to stdout (fd 1) or stderr (fd 2). In lean builds we flush the
+// application's stdio buffer first so our output stays in order with its own.
+// (cout is synchronized with stdio by default so this covers iostreams too.)
+static void writeOutput(int fd, string const& text) {
+#if defined(ARGS_LEAN) && defined(ARGS_POSIX)
+    fflush(fd == 2 ? stderr : stdout);
+    writeAll(fd, text.data(), text.size());
+#elif defined(ARGS_LEAN)
+    fwrite(text.data(), 1, text.size(), fd == 2 ? stderr : stdout);
+    fflush(fd == 2 ? stderr : stdout);
+#else
+    (fd == 2 ? cerr : cout) << text << flush;
+#endif
+}
+
+
+// Print an error message and exit.
+[[noreturn]] static void exitError(string const& message) {
+    writeOutput(2, "Error: " + message + "\n");
+    exit(1);
+}
+
+
 // -----------------------------------------------------------------------------
 // Flags and Options.
 // -----------------------------------------------------------------------------
 
 
+// Each flag and option is assigned a slot index on registration. Slots are
+// numbered from zero in registration order and identify the flag or option
+// in constraint bitmasks.
 struct args::Flag {
     int count = 0;
+    int slot = 0;
 };
 
 
 struct args::Option {
     vector<string> values;
     string fallback;
+    int slot = 0;
 };
 
 
@@ -36,8 +132,14 @@ struct args::Option {
 // -----------------------------------------------------------------------------
 
 
+// If the stream was created from the application's argv, [argv] points to the
+// first argument and args[i] is a copy of argv[i]. If [run_callbacks] is false,
+// found commands are parsed but their callbacks aren't called.
 struct args::ArgStream {
-    deque<string> args;
+    vector<string> args;
+    size_t index = 0;
+    char** argv = nullptr;
+    bool run_callbacks = true;
     void append(string const& arg);
     string next();
     bool hasNext();
@@ -50,14 +152,12 @@ void ArgStream::append(string const& arg) {
 
 
 string ArgStream::next() {
-    string arg = args.front();
-    args.pop_front();
-    return arg;
+    return args[index++];
 }
 
 
 bool ArgStream::hasNext() {
-    return args.size() > 0;
+    return index < args.size();
 }
 
 
@@ -66,24 +166,42 @@ bool ArgStream::hasNext() {
 // -----------------------------------------------------------------------------
 
 
+// Split a string of whitespace-separated names.
+static vector<string> splitNames(string const& names) {
+    vector<string> result;
+    size_t start = 0;
+    while ((start = names.find_first_not_of(" \t\r\n\v\f", start)) != string::npos) {
+        size_t end = names.find_first_of(" \t\r\n\v\f", start);
+        if (end == string::npos) {
+            end = names.size();
+        }
+        result.push_back(names.substr(start, end - start));
+        start = end;
+    }
+    return result;
+}
+
+
 void ArgParser::flag(string const& name) {
     Flag* flag = new Flag();
-    stringstream stream(name);
-    string alias;
-    while (stream >> alias) {
+    flag->slot = slot_names.size();
+    vector<string> aliases = splitNames(name);
+    for (string& alias: aliases) {
         flags[alias] = flag;
     }
+    slot_names.push_back(aliases.empty() ? "" : aliases[0]);
 }
 
 
 void ArgParser::option(string const& name, string const& fallback) {
     Option* option = new Option();
     option->fallback = fallback;
-    stringstream stream(name);
-    string alias;
-    while (stream >> alias) {
+    option->slot = slot_names.size();
+    vector<string> aliases = splitNames(name);
+    for (string& alias: aliases) {
         options[alias] = option;
     }
+    slot_names.push_back(aliases.empty() ? "" : aliases[0]);
 }
 
 
@@ -133,6 +251,251 @@ vector<string> ArgParser::values(string const& name) {
 }
 
 
+// -----------------------------------------------------------------------------
+// ArgParser: constraints.
+// -----------------------------------------------------------------------------
+
+
+// Constraints are resolved to slot indices when they're registered. Sets of
+// slots are stored as bitmasks so that checking them after parsing takes a
+// single pass over the registered flags and options to build a bitmask of the
+// slots found, then a single pass over the list of constraints.
+typedef vector<uint64_t> Bitmask;
+
+
+static void setBit(Bitmask& mask, int slot) {
+    size_t word = slot / 64;
+    if (mask.size() <= word) {
+        mask.resize(word + 1);
+    }
+    mask[word] |= uint64_t(1) << (slot % 64);
+}
+
+
+static bool testBit(Bitmask const& mask, int slot) {
+    size_t word = slot / 64;
+    return word < mask.size() && (mask[word] & (uint64_t(1) << (slot % 64)));
+}
+
+
+// Returns the slots set in [mask] but missing from [found].
+static Bitmask missing(Bitmask const& mask, Bitmask const& found) {
+    Bitmask result(mask.size());
+    for (size_t i = 0; i < mask.size(); i++) {
+        result[i] = mask[i] & ~(i < found.size() ? found[i] : 0);
+    }
+    return result;
+}
+
+
+// Returns the number of slots set in both [mask] and [found].
+static int countCommon(Bitmask const& mask, Bitmask const& found) {
+    int count = 0;
+    for (size_t i = 0; i < mask.size() && i < found.size(); i++) {
+        uint64_t bits = mask[i] & found[i];
+        while (bits) {
+            bits &= bits - 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+
+// Returns the lowest slot set in [mask] or -1 if none are set.
+static int firstBit(Bitmask const& mask) {
+    for (size_t i = 0; i < mask.size(); i++) {
+        for (int bit = 0; bit < 64; bit++) {
+            if (mask[i] & (uint64_t(1) << bit)) {
+                return i * 64 + bit;
+            }
+        }
+    }
+    return -1;
+}
+
+
+struct ArgParser::Constraints {
+    struct Dependency {
+        int slot;
+        Bitmask required;
+    };
+
+    struct Choices {
+        int slot;
+        vector<string> values;
+    };
+
+    struct Range {
+        int slot;
+        double min;
+        double max;
+    };
+
+    Bitmask required;
+    vector<Bitmask> exclusive;
+    vector<Dependency> dependencies;
+    vector<Choices> choices;
+    vector<Range> ranges;
+};
+
+
+// Check the registered constraints, if any, and exit with an error message if
+// any are violated.
+void ArgParser::checkConstraintsOrExit() {
+    string error;
+    if (constraints != nullptr && !checkConstraints(error)) {
+        exitError(error);
+    }
+}
+
+
+// Look up the slot for a registered flag or option. Constraints referring to
+// unregistered names are a programming error so we exit immediately.
+int ArgParser::slotFor(string const& name, bool options_only) {
+    if (options.count(name) > 0) {
+        return options[name]->slot;
+    }
+    if (flags.count(name) > 0 && !options_only) {
+        return flags[name]->slot;
+    }
+    exitError("'" + name + "' is not a registered " + (options_only ? "option" : "flag or option") + ".");
+}
+
+
+ArgParser::Constraints& ArgParser::getConstraints() {
+    if (constraints == nullptr) {
+        constraints = new Constraints();
+    }
+    return *constraints;
+}
+
+
+// Format a slot's name for an error message, e.g. --foo or -f.
+string ArgParser::displayName(int slot) {
+    string name = slot_names[slot];
+    return (name.size() == 1 ? "-" : "--") + name;
+}
+
+
+void ArgParser::require(string const& names) {
+    for (string& name: splitNames(names)) {
+        setBit(getConstraints().required, slotFor(name));
+    }
+}
+
+
+void ArgParser::exclusive(string const& names) {
+    Bitmask group;
+    for (string& name: splitNames(names)) {
+        setBit(group, slotFor(name));
+    }
+    getConstraints().exclusive.push_back(group);
+}
+
+
+void ArgParser::depends(string const& name, string const& names) {
+    Constraints::Dependency dependency;
+    dependency.slot = slotFor(name);
+    for (string& required: splitNames(names)) {
+        setBit(dependency.required, slotFor(required));
+    }
+    getConstraints().dependencies.push_back(dependency);
+}
+
+
+void ArgParser::choices(string const& name, string const& values) {
+    Constraints::Choices choices;
+    choices.slot = slotFor(name, true);
+    choices.values = splitNames(values);
+    getConstraints().choices.push_back(choices);
+}
+
+
+void ArgParser::range(string const& name, double min, double max) {
+    Constraints::Range range;
+    range.slot = slotFor(name, true);
+    range.min = min;
+    range.max = max;
+    getConstraints().ranges.push_back(range);
+}
+
+
+// Check the parsed values against the registered constraints. Returns false
+// if any are violated, with [error] describing the first violation.
+bool ArgParser::checkConstraints(string& error) {
+    Bitmask found;
+    vector<Option*> slot_options(slot_names.size(), nullptr);
+    for (auto element: flags) {
+        if (element.second->count > 0) {
+            setBit(found, element.second->slot);
+        }
+    }
+    for (auto element: options) {
+        slot_options[element.second->slot] = element.second;
+        if (element.second->values.size() > 0) {
+            setBit(found, element.second->slot);
+        }
+    }
+
+    int slot = firstBit(missing(constraints->required, found));
+    if (slot >= 0) {
+        error = displayName(slot) + " is required.";
+        return false;
+    }
+
+    for (Bitmask& group: constraints->exclusive) {
+        if (countCommon(group, found) > 1) {
+            Bitmask present = missing(group, missing(group, found));
+            int first = firstBit(present);
+            present[first / 64] &= ~(uint64_t(1) << (first % 64));
+            error = displayName(first) + " and " + displayName(firstBit(present)) + " cannot be used together.";
+            return false;
+        }
+    }
+
+    for (auto& dependency: constraints->dependencies) {
+        if (testBit(found, dependency.slot)) {
+            int slot = firstBit(missing(dependency.required, found));
+            if (slot >= 0) {
+                error = displayName(dependency.slot) + " requires " + displayName(slot) + ".";
+                return false;
+            }
+        }
+    }
+
+    for (auto& choices: constraints->choices) {
+        for (string& value: slot_options[choices.slot]->values) {
+            if (find(choices.values.begin(), choices.values.end(), value) == choices.values.end()) {
+                string message = "invalid value '" + value + "' for " + displayName(choices.slot) + ".";
+                message += " Valid choices are:";
+                for (size_t i = 0; i < choices.values.size(); i++) {
+                    message += (i ? ", " : " ") + choices.values[i];
+                }
+                error = message + ".";
+                return false;
+            }
+        }
+    }
+
+    for (auto& range: constraints->ranges) {
+        for (string& value: slot_options[range.slot]->values) {
+            char* end;
+            double number = strtod(value.c_str(), &end);
+            // Written so that NaN, which compares false with everything, fails.
+            if (value.empty() || *end != '\0' || !(number >= range.min && number <= range.max)) {
+                char bounds[64];
+                snprintf(bounds, sizeof(bounds), "%g and %g", range.min, range.max);
+                error = displayName(range.slot) + " must be a number between " + bounds + ".";
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
 // -----------------------------------------------------------------------------
 // ArgParser: commands.
 // -----------------------------------------------------------------------------
@@ -147,10 +510,7 @@ ArgParser& ArgParser::command(
     parser->helptext = helptext;
     parser->callback = callback;
 
-    stringstream stream(name);
-    string alias;
-
-    while (stream >> alias) {
+    for (string& alias: splitNames(name)) {
         commands[alias] = parser;
     }
 
@@ -178,42 +538,43 @@ ArgParser& ArgParser::commandParser() {
 // -----------------------------------------------------------------------------
 
 
-// Parse an option of the form --name=value or -n=value.
-void ArgParser::parseEqualsOption(string prefix, string name, string value) {
+// Parse an option of the form --name=value or -n=value. Returns false if the
+// option is unrecognised and [ignore_unknown] is set.
+bool ArgParser::parseEqualsOption(string prefix, string name, string value) {
     if (options.count(name) > 0) {
         if (value.size() > 0) {
             options[name]->values.push_back(value);
+            return true;
         } else {
-            cerr << "Error: missing value for " << prefix << name << ".\n";
-            exit(1);
+            exitError("missing value for " + prefix + name + ".");
         }
+    } else if (ignore_unknown) {
+        return false;
     } else {
-        cerr << "Error: " << prefix << name << " is not a recognised option.\n";
-        exit(1);
+        exitError(prefix + name + " is not a recognised option.");
     }
 }
 
 
 // Parse a long-form option, i.e. an option beginning with a double dash.
-void ArgParser::parseLongOption(string arg, ArgStream& stream) {
+// Returns false if the option is unrecognised and [ignore_unknown] is set.
+bool ArgParser::parseLongOption(string arg, ArgStream& stream) {
     size_t pos = arg.find("=");
     if (pos != string::npos) {
-        parseEqualsOption("--", arg.substr(0, pos), arg.substr(pos + 1));
-        return;
+        return parseEqualsOption("--", arg.substr(0, pos), arg.substr(pos + 1));
     }
 
     if (flags.count(arg) > 0) {
         flags[arg]->count++;
-        return;
+        return true;
     }
 
     if (options.count(arg) > 0) {
         if (stream.hasNext()) {
             options[arg]->values.push_back(stream.next());
-            return;
+            return true;
         } else {
-            cerr << "Error: missing argument for --" << arg << ".\n";
-            exit(1);
+            exitError("missing argument for --" + arg + ".");
         }
     }
 
@@ -225,17 +586,33 @@ void ArgParser::parseLongOption(string arg, ArgStream& stream) {
         exitVersion();
     }
 
-    cerr << "Error: --" << arg << " is not a recognised flag or option.\n";
-    exit(1);
+    if (ignore_unknown) {
+        return false;
+    }
+
+    exitError("--" + arg + " is not a recognised flag or option.");
 }
 
 
 // Parse a short-form option, i.e. an option beginning with a single dash.
-void ArgParser::parseShortOption(string arg, ArgStream& stream) {
+// Returns false if the option is unrecognised and [ignore_unknown] is set.
+bool ArgParser::parseShortOption(string arg, ArgStream& stream) {
     size_t pos = arg.find("=");
     if (pos != string::npos) {
-        parseEqualsOption("-", arg.substr(0, pos), arg.substr(pos + 1));
-        return;
+        return parseEqualsOption("-", arg.substr(0, pos), arg.substr(pos + 1));
+    }
+
+    // A condensed group like -abc is passed through intact if any of its
+    // characters is unrecognised, in which case none of them are applied.
+    if (ignore_unknown) {
+        for (char& c: arg) {
+            string name = string(1, c);
+            bool is_help = c == 'h' && this->helptext != "";
+            bool is_version = c == 'v' && this->version != "";
+            if (flags.count(name) == 0 && options.count(name) == 0 && !is_help && !is_version) {
+                return false;
+            }
+        }
     }
 
     for (char& c: arg) {
@@ -252,11 +629,10 @@ void ArgParser::parseShortOption(string arg, ArgStream& stream) {
                 continue;
             } else {
                 if (arg.size() > 1) {
-                    cerr << "Error: missing argument for '" << c << "' in -" << arg << ".\n";
+                    exitError("missing argument for '" + name + "' in -" + arg + ".");
                 } else {
-                    cerr << "Error: missing argument for -" << c << ".\n";
+                    exitError("missing argument for -" + name + ".");
                 }
-                exit(1);
             }
         }
 
@@ -269,12 +645,59 @@ void ArgParser::parseShortOption(string arg, ArgStream& stream) {
         }
 
         if (arg.size() > 1) {
-            cerr << "Error: '" << c << "' in -" << arg << " is not a recognised flag or option.\n";
+            exitError("'" + name + "' in -" + arg + " is not a recognised flag or option.");
         } else {
-            cerr << "Error: -" << c << " is not a recognised flag or option.\n";
+            exitError("-" + name + " is not a recognised flag or option.");
         }
-        exit(1);
     }
+
+    return true;
+}
+
+
+// Add the argument at [index] in the stream to the list of unparsed arguments.
+void ArgParser::addRest(ArgStream& stream, size_t index) {
+    rest.push_back(stream.args[index]);
+    rest_indices.push_back(index);
+}
+
+
+// Point [rest_argv] at the unparsed arguments in the original argv. If they
+// form its tail we can point directly into it; otherwise we collect pointers
+// to the original strings.
+void ArgParser::setRestArgv(ArgStream& stream) {
+    rest_argv.clear();
+    rest_argv_ptr = nullptr;
+    if (stream.argv == nullptr) {
+        return;
+    }
+
+    size_t start = stream.args.size() - rest_indices.size();
+    bool is_tail = true;
+    for (size_t i = 0; i < rest_indices.size(); i++) {
+        if (rest_indices[i] != start + i) {
+            is_tail = false;
+            break;
+        }
+    }
+
+    if (is_tail) {
+        rest_argv_ptr = stream.argv + start;
+        return;
+    }
+
+    for (size_t index: rest_indices) {
+        rest_argv.push_back(stream.argv[index]);
+    }
+    rest_argv.push_back(nullptr);
+    rest_argv_ptr = rest_argv.data();
+}
+
+
+// Returns the unparsed arguments as a NULL-terminated array suitable for
+// passing to execv(). Returns nullptr unless parsing the application's argv.
+char** ArgParser::restArgv() {
+    return rest_argv_ptr;
 }
 
 
@@ -283,40 +706,63 @@ void ArgParser::parse(ArgStream& stream) {
     bool is_first_arg = true;
 
     while (stream.hasNext()) {
+        size_t index = stream.index;
         string arg = stream.next();
 
         // If we enounter a '--', turn off option parsing.
         if (arg == "--") {
             while (stream.hasNext()) {
-                args.push_back(stream.next());
+                if (stop_at_positional) {
+                    addRest(stream, stream.index++);
+                } else {
+                    args.push_back(stream.next());
+                }
             }
             continue;
         }
 
         // Is the argument a long-form option or flag?
         if (arg.compare(0, 2, "--") == 0) {
-            parseLongOption(arg.substr(2), stream);
+            if (!parseLongOption(arg.substr(2), stream)) {
+                addRest(stream, index);
+            }
             continue;
         }
 
         // Is the argument a short-form option or flag? If the argument
         // consists of a single dash or a dash followed by a digit, we treat
         // it as a positional argument.
-        if (arg[0] == '-') {
-            if (arg.size() == 1 || isdigit(arg[1])) {
-                args.push_back(arg);
-            } else {
-                parseShortOption(arg.substr(1), stream);
+        if (arg[0] == '-' && arg.size() > 1 && !isdigit(arg[1])) {
+            if (!parseShortOption(arg.substr(1), stream)) {
+                addRest(stream, index);
+            }
+            continue;
+        }
+
+        // In partial mode, the first positional argument or command ends
+        // parsing.
+        if (stop_at_positional) {
+            addRest(stream, index);
+            while (stream.hasNext()) {
+                addRest(stream, stream.index++);
             }
             continue;
         }
 
+        if (arg[0] == '-') {
+            args.push_back(arg);
+            continue;
+        }
+
         // Is the argument a registered command?
         if (is_first_arg && commands.count(arg) > 0) {
+            // Check our own constraints before the command's callback can
+            // run. The command consumes all the remaining arguments.
+            checkConstraintsOrExit();
             ArgParser* command_parser = commands[arg];
             command_name = arg;
             command_parser->parse(stream);
-            if (command_parser->callback != nullptr) {
+            if (stream.run_callbacks && command_parser->callback != nullptr) {
                 command_parser->callback(arg, *command_parser);
             }
             continue;
@@ -327,14 +773,12 @@ void ArgParser::parse(ArgStream& stream) {
             if (stream.hasNext()) {
                 string name = stream.next();
                 if (commands.find(name) == commands.end()) {
-                    cerr << "Error: '" << name << "' is not a recognised command.\n";
-                    exit(1);
+                    exitError("'" + name + "' is not a recognised command.");
                 } else {
                     commands[name]->exitHelp();
                 }
             } else {
-                cerr << "Error: the help command requires an argument.\n";
-                exit(1);
+                exitError("the help command requires an argument.");
             }
         }
 
@@ -342,6 +786,12 @@ void ArgParser::parse(ArgStream& stream) {
         args.push_back(arg);
         is_first_arg = false;
     }
+
+    if (!commandFound()) {
+        checkConstraintsOrExit();
+    }
+
+    setRestArgv(stream);
 }
 
 
@@ -350,8 +800,9 @@ void ArgParser::parse(ArgStream& stream) {
 // situations [argv] can be empty, i.e. [argc == 0]. This can lead to security
 // vulnerabilities if not handled explicitly.
 void ArgParser::parse(int argc, char **argv) {
-    if (argc > 1) {
+    if (argc > 0) {
         ArgStream stream;
+        stream.argv = argv + 1;
         for (int i = 1; i < argc; i++) {
             stream.append(argv[i]);
         }
@@ -370,108 +821,1206 @@ void ArgParser::parse(vector<string> args) {
 }
 
 
+#ifndef ARGS_LEAN
+
+
 // -----------------------------------------------------------------------------
-// ArgParser: utilities.
+// ArgParser: config files.
 // -----------------------------------------------------------------------------
 
 
-// Override the << stream insertion operator to support vectors. This will
-// allow us to cout our lists of option values in the print() method.
-template<typename T>
-static ostream& operator<<(ostream& stream, const vector<T>& vec) {
-    stream << "[";
-    for(size_t i = 0; i < vec.size(); ++i) {
-        if (i) cout << ", ";
-        stream << vec[i];
+static string trim(string const& str) {
+    size_t start = str.find_first_not_of(" \t\r\n");
+    if (start == string::npos) {
+        return string();
     }
-    stream << "]";
-    return stream;
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(start, end - start + 1);
 }
 
 
-// Dump the parser's state to stdout.
-void ArgParser::print() {
-    cout << "Options:\n";
-    if (options.size() > 0) {
-        for (auto element: options) {
-            cout << "  " << element.first << ": ";
-            Option *option = element.second;
-            cout << "(" << option->fallback << ") ";
-            cout << option->values;
-            cout << "\n";
-        }
-    } else {
-        cout << "  [none]\n";
+// Overlay values from a config file onto the parser's results. Each line has
+// the form 'name = value'; blank lines and lines beginning with '#' are
+// ignored. An option's value replaces any values it already has; a flag's
+// value is its count, with 'true' and 'false' accepted for 1 and 0.
+bool ArgParser::loadConfig(string const& path, string& error) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        error = "cannot open '" + path + "'";
+        return false;
     }
 
-    cout << "\nFlags:\n";
-    if (flags.size() > 0) {
-        for (auto element: flags) {
-            cout << "  " << element.first << ": " << element.second->count << "\n";
-        }
-    } else {
-        cout << "  [none]\n";
+    string text;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, n);
     }
+    fclose(file);
 
-    cout << "\nArguments:\n";
-    if (args.size() > 0) {
-        for (auto arg: args) {
-            cout << "  " << arg << "\n";
+    size_t line_start = 0;
+    for (int line_number = 1; line_start < text.size(); line_number++) {
+        size_t line_end = text.find('\n', line_start);
+        if (line_end == string::npos) {
+            line_end = text.size();
         }
-    } else {
-        cout << "  [none]\n";
-    }
+        string line = trim(text.substr(line_start, line_end - line_start));
+        line_start = line_end + 1;
 
-    cout << "\nCommand:\n";
-    if (commandFound()) {
-        cout << "  " << command_name << "\n";
-    } else {
-        cout << "  [none]\n";
-    }
-}
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
 
+        string where = path + ":" + to_string(line_number);
+        size_t pos = line.find('=');
+        if (pos == string::npos) {
+            error = where + ": expected 'name = value'";
+            return false;
+        }
 
-// Print the parser's help text and exit.
-void ArgParser::exitHelp() {
-    cout << helptext << endl;
-    exit(0);
-}
+        string name = trim(line.substr(0, pos));
+        string value = trim(line.substr(pos + 1));
 
+        if (flags.count(name) > 0) {
+            if (value == "true") {
+                flags[name]->count = 1;
+            } else if (value == "false") {
+                flags[name]->count = 0;
+            } else if (!value.empty() && value.size() < 10 && value.find_first_not_of("0123456789") == string::npos) {
+                flags[name]->count = stoi(value);
+            } else {
+                error = where + ": invalid value for flag '" + name + "'";
+                return false;
+            }
+        } else if (options.count(name) > 0) {
+            options[name]->values = vector<string>({value});
+        } else {
+            error = where + ": '" + name + "' is not a recognised flag or option";
+            return false;
+        }
+    }
 
-// Print the parser's version string and exit.
-void ArgParser::exitVersion() {
-    cout << version << endl;
-    exit(0);
+    return true;
 }
 
 
+#endif // ARGS_LEAN
+
+
 // -----------------------------------------------------------------------------
-// ArgParser: cleanup.
+// FrozenArgs.
 // -----------------------------------------------------------------------------
 
 
-ArgParser::~ArgParser() {
-    set<Option*> unique_options;
-    for (auto element: options) {
-        unique_options.insert(element.second);
+// A frozen block is a flat byte array. All references within the block are
+// 32-bit offsets from its start; strings are stored NUL-terminated so they
+// can be returned directly. Each parser in the chain of found commands is
+// stored as a Node with a sorted array of Entry records, one per flag or
+// option alias, and an array of string offsets for its positional arguments.
+
+
+static const uint32_t NONE = UINT32_MAX;
+
+
+struct FrozenArgs::Node {
+    uint32_t num_entries;
+    uint32_t entries;
+    uint32_t num_args;
+    uint32_t args;
+    uint32_t command_name;
+    uint32_t command;
+};
+
+
+struct FrozenArgs::Entry {
+    uint32_t name;
+    uint32_t count;
+    uint32_t values;
+    uint32_t fallback;
+};
+
+
+FrozenArgs::FrozenArgs() : node(NONE) {}
+
+
+FrozenArgs::FrozenArgs(shared_ptr<char const> block, uint32_t node)
+    : block(block), node(node) {}
+
+
+FrozenArgs::Node const* FrozenArgs::getNode() const {
+    if (node == NONE) {
+        return nullptr;
     }
-    for (auto pointer: unique_options) {
-        delete pointer;
+    return reinterpret_cast<Node const*>(block.get() + node);
+}
+
+
+// Binary search the node's entries for the specified name.
+FrozenArgs::Entry const* FrozenArgs::find(char const* name) const {
+    Node const* n = getNode();
+    if (n == nullptr) {
+        return nullptr;
+    }
+    Entry const* entries = reinterpret_cast<Entry const*>(block.get() + n->entries);
+    size_t lo = 0;
+    size_t hi = n->num_entries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(name, block.get() + entries[mid].name);
+        if (cmp == 0) {
+            return &entries[mid];
+        }
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
     }
+    return nullptr;
+}
 
-    set<Flag*> unique_flags;
-    for (auto element: flags) {
-        unique_flags.insert(element.second);
+
+bool FrozenArgs::found(char const* name) const {
+    return count(name) > 0;
+}
+
+
+int FrozenArgs::count(char const* name) const {
+    Entry const* entry = find(name);
+    return entry ? entry->count : 0;
+}
+
+
+// Returns the option's last value, its fallback value if it wasn't found, or
+// an empty string if it isn't a registered option.
+char const* FrozenArgs::value(char const* name) const {
+    Entry const* entry = find(name);
+    if (entry == nullptr || entry->fallback == NONE) {
+        return "";
     }
-    for (auto pointer: unique_flags) {
-        delete pointer;
+    if (entry->count > 0) {
+        return value(name, entry->count - 1);
     }
+    return block.get() + entry->fallback;
+}
 
-    set<ArgParser*> unique_cmd_parsers;
-    for (auto element: commands) {
-        unique_cmd_parsers.insert(element.second);
+
+// Returns the option's value at [index], or nullptr if out of range.
+char const* FrozenArgs::value(char const* name, int index) const {
+    Entry const* entry = find(name);
+    if (entry == nullptr || entry->fallback == NONE || index < 0 || (uint32_t)index >= entry->count) {
+        return nullptr;
     }
-    for (auto pointer: unique_cmd_parsers) {
-        delete pointer;
+    uint32_t const* values = reinterpret_cast<uint32_t const*>(block.get() + entry->values);
+    return block.get() + values[index];
+}
+
+
+int FrozenArgs::numArgs() const {
+    Node const* n = getNode();
+    return n ? n->num_args : 0;
+}
+
+
+// Returns the positional argument at [index], or nullptr if out of range.
+char const* FrozenArgs::arg(int index) const {
+    Node const* n = getNode();
+    if (n == nullptr || index < 0 || (uint32_t)index >= n->num_args) {
+        return nullptr;
     }
+    uint32_t const* args = reinterpret_cast<uint32_t const*>(block.get() + n->args);
+    return block.get() + args[index];
+}
+
+
+bool FrozenArgs::commandFound() const {
+    Node const* n = getNode();
+    return n && n->command != NONE;
+}
+
+
+char const* FrozenArgs::commandName() const {
+    Node const* n = getNode();
+    return (n && n->command_name != NONE) ? block.get() + n->command_name : "";
+}
+
+
+FrozenArgs FrozenArgs::commandArgs() const {
+    Node const* n = getNode();
+    return FrozenArgs(block, n ? n->command : NONE);
+}
+
+
+// Accumulates a frozen block. Records are 4-byte aligned; offsets stay valid
+// as the buffer grows, pointers don't, so records are written by offset.
+// Offsets are 32 bits wide with UINT32_MAX reserved for NONE, so a block is
+// limited to just under 4 GiB; we throw rather than truncate an offset.
+struct args::FreezeBuffer {
+    vector<char> bytes;
+
+    void checkSize(size_t size) {
+        if (size >= NONE) {
+            throw length_error("args::ArgParser::freeze: results exceed 4 GiB");
+        }
+    }
+
+    uint32_t reserve(size_t size) {
+        size_t offset = (bytes.size() + 3) & ~size_t(3);
+        checkSize(offset + size);
+        bytes.resize(offset + size);
+        return offset;
+    }
+
+    uint32_t addString(string const& str) {
+        size_t offset = bytes.size();
+        checkSize(offset + str.size() + 1);
+        bytes.insert(bytes.end(), str.c_str(), str.c_str() + str.size() + 1);
+        return offset;
+    }
+
+    template<typename T>
+    void write(uint32_t offset, T const& record) {
+        memcpy(&bytes[offset], &record, sizeof(T));
+    }
+};
+
+
+// Append the parser's results to the buffer. Returns the node's offset.
+uint32_t ArgParser::freeze(FreezeBuffer& buffer) {
+    // Merge the flag and option aliases in sorted order. If a name is
+    // registered as both, the flag wins, as in found() and count().
+    map<string, pair<Flag*, Option*>> names;
+    for (auto element: options) {
+        names[element.first].second = element.second;
+    }
+    for (auto element: flags) {
+        names[element.first] = make_pair(element.second, (Option*)nullptr);
+    }
+
+    uint32_t node_offset = buffer.reserve(sizeof(FrozenArgs::Node));
+    FrozenArgs::Node node;
+    node.num_entries = names.size();
+    node.entries = buffer.reserve(names.size() * sizeof(FrozenArgs::Entry));
+    node.num_args = args.size();
+    node.args = buffer.reserve(args.size() * sizeof(uint32_t));
+    node.command_name = NONE;
+    node.command = NONE;
+
+    for (size_t i = 0; i < args.size(); i++) {
+        buffer.write(node.args + i * sizeof(uint32_t), buffer.addString(args[i]));
+    }
+
+    uint32_t entry_offset = node.entries;
+    for (auto element: names) {
+        FrozenArgs::Entry entry;
+        entry.name = buffer.addString(element.first);
+        entry.values = NONE;
+        entry.fallback = NONE;
+        if (element.second.first != nullptr) {
+            entry.count = element.second.first->count;
+        } else {
+            Option* option = element.second.second;
+            entry.count = option->values.size();
+            entry.fallback = buffer.addString(option->fallback);
+            entry.values = buffer.reserve(option->values.size() * sizeof(uint32_t));
+            for (size_t i = 0; i < option->values.size(); i++) {
+                buffer.write(entry.values + i * sizeof(uint32_t), buffer.addString(option->values[i]));
+            }
+        }
+        buffer.write(entry_offset, entry);
+        entry_offset += sizeof(FrozenArgs::Entry);
+    }
+
+    if (commandFound()) {
+        node.command_name = buffer.addString(command_name);
+        node.command = commands[command_name]->freeze(buffer);
+    }
+
+    buffer.write(node_offset, node);
+    return node_offset;
+}
+
+
+// Copy the parser's results into a single immutable allocation sized to fit.
+FrozenArgs ArgParser::freeze() {
+    FreezeBuffer buffer;
+    uint32_t root = freeze(buffer);
+    char* block = new char[buffer.bytes.size()];
+    memcpy(block, buffer.bytes.data(), buffer.bytes.size());
+    return FrozenArgs(shared_ptr<char const>(block, default_delete<char[]>()), root);
+}
+
+
+#ifndef ARGS_LEAN
+
+
+// -----------------------------------------------------------------------------
+// ArgParser: batch mode.
+// -----------------------------------------------------------------------------
+
+
+// Create a fresh copy of the parser's registered flags, options, and commands.
+// Parsed results are copied only if [with_results] is true. Aliases continue
+// to share a single instance.
+ArgParser* ArgParser::clone(bool with_results) {
+    ArgParser* parser = new ArgParser(helptext, version);
+    parser->callback = callback;
+    parser->ignore_unknown = ignore_unknown;
+    parser->stop_at_positional = stop_at_positional;
+    parser->slot_names = slot_names;
+    if (constraints != nullptr) {
+        parser->constraints = new Constraints(*constraints);
+    }
+    if (with_results) {
+        parser->args = args;
+        parser->rest = rest;
+        parser->command_name = command_name;
+    }
+
+    map<Option*, Option*> option_copies;
+    for (auto element: options) {
+        Option*& copy = option_copies[element.second];
+        if (copy == nullptr) {
+            copy = new Option();
+            copy->fallback = element.second->fallback;
+            copy->slot = element.second->slot;
+            if (with_results) {
+                copy->values = element.second->values;
+            }
+        }
+        parser->options[element.first] = copy;
+    }
+
+    map<Flag*, Flag*> flag_copies;
+    for (auto element: flags) {
+        Flag*& copy = flag_copies[element.second];
+        if (copy == nullptr) {
+            copy = new Flag();
+            copy->slot = element.second->slot;
+            if (with_results) {
+                copy->count = element.second->count;
+            }
+        }
+        parser->flags[element.first] = copy;
+    }
+
+    map<ArgParser*, ArgParser*> command_copies;
+    for (auto element: commands) {
+        ArgParser*& copy = command_copies[element.second];
+        if (copy == nullptr) {
+            copy = element.second->clone(with_results);
+        }
+        parser->commands[element.first] = copy;
+    }
+
+    return parser;
+}
+
+
+// Call the callbacks for a command and any nested commands found within it,
+// innermost first, as parse() would have done.
+static void runCallbacks(string const& name, ArgParser& parser) {
+    if (parser.commandFound()) {
+        runCallbacks(parser.commandName(), parser.commandParser());
+    }
+    if (parser.callback != nullptr) {
+        parser.callback(name, parser);
+    }
+}
+
+
+// Parse a list of command invocations separated by the configured separator
+// token, e.g. "cmd1 --foo + cmd2 arg + cmd1 --bar". Each invocation is parsed
+// with a fresh copy of its command's parser, so the same command can appear
+// more than once. All invocations, including any nested commands, are parsed
+// up front with callbacks disabled, so a malformed invocation exits with an
+// error before any work is done. Each invocation's callbacks then run on a
+// pool of at most [config.max_workers] threads.
+vector<BatchResult> ArgParser::parseBatch(vector<string> args, BatchConfig const& config) {
+    vector<vector<string>> segments(1);
+    for (string& arg: args) {
+        if (arg == config.separator) {
+            segments.emplace_back();
+        } else {
+            segments.back().push_back(arg);
+        }
+    }
+
+    vector<BatchResult> results;
+    for (auto& segment: segments) {
+        if (segment.empty()) {
+            continue;
+        }
+        string name = segment.front();
+        if (commands.count(name) == 0) {
+            exitError("'" + name + "' is not a recognised command.");
+        }
+        ArgStream stream;
+        stream.run_callbacks = false;
+        for (size_t i = 1; i < segment.size(); i++) {
+            stream.append(segment[i]);
+        }
+        BatchResult result;
+        result.command = name;
+        result.parser = shared_ptr<ArgParser>(commands[name]->clone());
+        result.parser->parse(stream);
+        results.push_back(result);
+    }
+
+    size_t num_workers = config.max_workers > 0 ?
+        config.max_workers : max(1u, thread::hardware_concurrency());
+    num_workers = min(num_workers, results.size());
+
+    atomic<size_t> next_index(0);
+    mutex report_mutex;
+    vector<bool> completed(results.size(), false);
+    size_t next_to_report = 0;
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next_index++) < results.size()) {
+            BatchResult& result = results[i];
+            try {
+                runCallbacks(result.command, *result.parser);
+            } catch (exception& e) {
+                result.ok = false;
+                result.error = e.what();
+            } catch (...) {
+                result.ok = false;
+                result.error = "unknown exception";
+            }
+            if (config.on_result == nullptr) {
+                continue;
+            }
+            lock_guard<mutex> lock(report_mutex);
+            if (config.ordered) {
+                completed[i] = true;
+                while (next_to_report < results.size() && completed[next_to_report]) {
+                    config.on_result(results[next_to_report++]);
+                }
+            } else {
+                config.on_result(result);
+            }
+        }
+    };
+
+    vector<thread> pool;
+    for (size_t i = 1; i < num_workers; i++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& t: pool) {
+        t.join();
+    }
+
+    return results;
+}
+
+
+// Parse the application's command line arguments in batch mode. As with
+// parse(), we skip the first element of [argv].
+vector<BatchResult> ArgParser::parseBatch(int argc, char **argv, BatchConfig const& config) {
+    vector<string> args;
+    for (int i = 1; i < argc; i++) {
+        args.push_back(argv[i]);
+    }
+    return parseBatch(args, config);
+}
+
+
+// -----------------------------------------------------------------------------
+// Server mode.
+// -----------------------------------------------------------------------------
+
+
+#ifdef ARGS_POSIX
+
+
+// A forwarded invocation is sent as a fixed-size header followed by a block of
+// NUL-terminated strings: the working directory, the [argc] arguments, and the
+// [envc] environment entries. The client's stdin, stdout, and stderr file
+// descriptors travel with the header as SCM_RIGHTS ancillary data. The server
+// replies with the invocation's exit status.
+struct RequestHeader {
+    uint32_t size;
+    uint32_t argc;
+    uint32_t envc;
+};
+
+
+static bool readAll(int fd, void* buffer, size_t size) {
+    char* ptr = static_cast<char*>(buffer);
+    while (size > 0) {
+        ssize_t n = read(fd, ptr, size);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+
+static void setNoSigpipe(int sock) {
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+
+// Like writeAll() but for sockets: a peer that has closed the connection
+// gives an error rather than raising SIGPIPE.
+static bool sendAll(int sock, void const* buffer, size_t size) {
+    char const* ptr = static_cast<char const*>(buffer);
+    while (size > 0) {
+        ssize_t n = send(sock, ptr, size, ARGS_MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+
+static bool makeAddress(string const& path, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    return true;
+}
+
+
+// Receive a request header along with its three file descriptors.
+static bool recvHeader(int conn, RequestHeader& header, int fds[3]) {
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    iovec iov;
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(conn, &msg, 0);
+    if (n <= 0) {
+        return false;
+    }
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))) {
+        return false;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+
+    if (n < static_cast<ssize_t>(sizeof(header))) {
+        return readAll(conn, reinterpret_cast<char*>(&header) + n, sizeof(header) - n);
+    }
+    return true;
+}
+
+
+// Runs in the forked worker. [parser] is the server's unused copy of its
+// parser, so each worker starts from a clean state.
+static void runRequest(ArgParser& parser, int fds[3], vector<char>& block, RequestHeader& header) {
+    for (int i = 0; i < 3; i++) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+
+    vector<char*> strings;
+    for (size_t i = 0; i < block.size(); i += strlen(&block[i]) + 1) {
+        strings.push_back(&block[i]);
+    }
+    if (strings.size() != 1 + header.argc + header.envc) {
+        exit(1);
+    }
+
+    if (chdir(strings[0]) != 0) {
+        exitError("cannot change directory to '" + string(strings[0]) + "'.");
+    }
+
+    vector<char*> argv(strings.begin() + 1, strings.begin() + 1 + header.argc);
+    argv.push_back(nullptr);
+    vector<char*> env(strings.begin() + 1 + header.argc, strings.end());
+    env.push_back(nullptr);
+    environ = env.data();
+
+    parser.parse(header.argc, argv.data());
+    exit(0);
+}
+
+
+// Workers still running, mapped to the connections awaiting their status.
+struct ServerState {
+    mutex lock;
+    condition_variable started;
+    map<pid_t, int> clients;
+};
+
+
+// Wait for workers to exit and report their exit status to their clients.
+// The accept loop holds the lock from fork() until the worker is registered,
+// so a worker that exits immediately can't be reaped before it's known.
+static void reapWorkers(shared_ptr<ServerState> state) {
+    while (true) {
+        int wstatus;
+        pid_t pid = waitpid(-1, &wstatus, 0);
+        if (pid < 0) {
+            if (errno == ECHILD) {
+                unique_lock<mutex> lock(state->lock);
+                state->started.wait(lock, [&]() { return !state->clients.empty(); });
+            }
+            continue;
+        }
+
+        lock_guard<mutex> lock(state->lock);
+        auto client = state->clients.find(pid);
+        if (client == state->clients.end()) {
+            continue;
+        }
+
+        int32_t status = 1;
+        if (WIFEXITED(wstatus)) {
+            status = WEXITSTATUS(wstatus);
+        } else if (WIFSIGNALED(wstatus)) {
+            status = 128 + WTERMSIG(wstatus);
+        }
+        sendAll(client->second, &status, sizeof(status));
+        close(client->second);
+        state->clients.erase(client);
+    }
+}
+
+
+// Receive a forwarded invocation and fork a worker to run it. Forking per
+// invocation keeps the server's application state shared copy-on-write,
+// and isolates the server from exit() calls, stream redirection, and
+// working-directory changes made while the invocation runs. Returns false
+// if the connection should be closed.
+static bool startRequest(ArgParser& parser, int sock, int conn, ServerState& state) {
+    setNoSigpipe(conn);
+
+    // Don't let a stalled client hold up the accept loop.
+    timeval timeout = {5, 0};
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    RequestHeader header;
+    int fds[3];
+    if (!recvHeader(conn, header, fds)) {
+        return false;
+    }
+
+    vector<char> block(header.size);
+    if (!readAll(conn, block.data(), block.size()) || block.empty() || block.back() != '\0') {
+        for (int i = 0; i < 3; i++) {
+            close(fds[i]);
+        }
+        return false;
+    }
+
+    // Flush anything the server has buffered, or the worker would flush its
+    // copy on exit to the client's streams instead.
+#ifndef ARGS_LEAN
+    cout.flush();
+    cerr.flush();
+#endif
+    fflush(nullptr);
+
+    lock_guard<mutex> lock(state.lock);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(sock);
+        close(conn);
+        runRequest(parser, fds, block, header);
+    }
+    for (int i = 0; i < 3; i++) {
+        close(fds[i]);
+    }
+    if (pid < 0) {
+        return false;
+    }
+
+    state.clients[pid] = conn;
+    state.started.notify_one();
+    return true;
+}
+
+
+// Remove a stale socket left behind by a server that has exited. Returns false
+// if the path exists but isn't a socket, or if a server is still listening.
+static bool removeStaleSocket(string const& path, sockaddr_un& addr) {
+    struct stat info;
+    if (lstat(path.c_str(), &info) != 0) {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(info.st_mode)) {
+        return false;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return false;
+    }
+    bool is_live = connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    close(sock);
+
+    return !is_live && unlink(path.c_str()) == 0;
+}
+
+
+bool ArgParser::serve(string const& socket_path) {
+    sockaddr_un addr;
+    if (!makeAddress(socket_path, addr) || !removeStaleSocket(socket_path, addr)) {
+        return false;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return false;
+    }
+
+    if (bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(sock, 64) != 0) {
+        close(sock);
+        return false;
+    }
+
+    // We can't collect the workers' exit statuses if SIGCHLD is ignored.
+    // Note that the reaper collects any other child processes too.
+    signal(SIGCHLD, SIG_DFL);
+    shared_ptr<ServerState> state = make_shared<ServerState>();
+
+    // The server may have used this parser for parsing its own arguments, so
+    // workers parse with a copy that's never used in the server itself.
+    unique_ptr<ArgParser> fresh(clone());
+    thread(reapWorkers, state).detach();
+
+    while (true) {
+        int conn = accept(sock, nullptr, nullptr);
+
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            // Out of file descriptors or memory: wait for workers to exit.
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                usleep(100000);
+                continue;
+            }
+            close(sock);
+            return false;
+        }
+
+        if (!startRequest(*fresh, sock, conn, *state)) {
+            close(conn);
+        }
+    }
+}
+
+
+int args::forward(string const& socket_path, int argc, char **argv) {
+    sockaddr_un addr;
+    if (!makeAddress(socket_path, addr)) {
+        return -1;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    setNoSigpipe(sock);
+
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(sock);
+        return -1;
+    }
+
+    vector<char> block;
+    auto append = [&](char const* str) {
+        block.insert(block.end(), str, str + strlen(str) + 1);
+    };
+
+    vector<char> cwd(4096);
+    while (getcwd(cwd.data(), cwd.size()) == nullptr) {
+        if (errno != ERANGE) {
+            close(sock);
+            return -1;
+        }
+        cwd.resize(cwd.size() * 2);
+    }
+    append(cwd.data());
+
+    for (int i = 0; i < argc; i++) {
+        append(argv[i]);
+    }
+
+    RequestHeader header;
+    header.argc = argc;
+    header.envc = 0;
+    for (char** env = environ; *env != nullptr; env++) {
+        append(*env);
+        header.envc++;
+    }
+    header.size = block.size();
+
+    int fds[3] = {0, 1, 2};
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    iovec iov;
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    int32_t status = -1;
+    if (sendmsg(sock, &msg, ARGS_MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(header)) ||
+        !sendAll(sock, block.data(), block.size()) ||
+        !readAll(sock, &status, sizeof(status))) {
+        status = -1;
+    }
+
+    close(sock);
+    return status;
+}
+
+
+#else
+
+
+bool ArgParser::serve(string const& socket_path) {
+    return false;
+}
+
+
+int args::forward(string const& socket_path, int argc, char **argv) {
+    return -1;
+}
+
+
+#endif
+
+
+// -----------------------------------------------------------------------------
+// LiveArgs.
+// -----------------------------------------------------------------------------
+
+
+// Snapshots are reclaimed using a pair of reader counters in the style of
+// userspace RCU. A reader increments the counter selected by the current
+// phase, loads the snapshot pointer, and decrements the same counter when
+// done. A reload publishes its new snapshot, then flips the phase and waits
+// for each counter in turn to drain. Any reader still holding the old pointer
+// must have incremented one of the counters before the new pointer was
+// published, so once both have drained the old snapshot can be freed. The
+// phase flip directs new readers to the other counter so the wait finishes.
+struct args::LiveState {
+    ArgParser* base = nullptr;
+    string config_path;
+
+    atomic<FrozenArgs*> current;
+    atomic<unsigned> phase;
+    atomic<unsigned> readers[2];
+    mutex reload_mutex;
+
+    thread watcher;
+    int stop_pipe[2] = {-1, -1};
+
+    void synchronize();
+    bool reload(string& error);
+};
+
+
+void LiveState::synchronize() {
+    for (int i = 0; i < 2; i++) {
+        unsigned slot = phase.fetch_add(1) & 1;
+        while (readers[slot].load() != 0) {
+            this_thread::yield();
+        }
+    }
+}
+
+
+LiveArgs::LiveArgs(ArgParser& parser, string const& config_path) {
+    state = new LiveState();
+    state->base = parser.clone(true);
+    state->config_path = config_path;
+    state->current = new FrozenArgs(parser.freeze());
+    state->phase = 0;
+    state->readers[0] = 0;
+    state->readers[1] = 0;
+}
+
+
+LiveArgs::~LiveArgs() {
+#ifdef ARGS_POSIX
+    if (state->watcher.joinable()) {
+        char c = 0;
+        writeAll(state->stop_pipe[1], &c, 1);
+        state->watcher.join();
+        close(state->stop_pipe[0]);
+        close(state->stop_pipe[1]);
+    }
+#endif
+    delete state->current.load();
+    delete state->base;
+    delete state;
+}
+
+
+// The error callback is called after the reload lock is released so that it
+// can safely call reload() itself.
+bool LiveArgs::reload(string* error) {
+    string message;
+    if (state->reload(message)) {
+        return true;
+    }
+    if (error != nullptr) {
+        *error = message;
+    }
+    if (on_error != nullptr) {
+        on_error(message);
+    }
+    return false;
+}
+
+
+bool LiveState::reload(string& error) {
+    lock_guard<mutex> lock(reload_mutex);
+
+    ArgParser* parser = base->clone(true);
+    if (config_path != "" && !parser->loadConfig(config_path, error)) {
+        delete parser;
+        return false;
+    }
+
+    string violation;
+    if (parser->constraints != nullptr && !parser->checkConstraints(violation)) {
+        error = config_path + ": " + violation;
+        delete parser;
+        return false;
+    }
+
+    FrozenArgs* snapshot = new FrozenArgs(parser->freeze());
+    delete parser;
+
+    FrozenArgs* old = current.exchange(snapshot);
+    synchronize();
+    delete old;
+    return true;
+}
+
+
+string LiveArgs::value(char const* name) {
+    Reader reader(*this);
+    return reader->value(name);
+}
+
+
+LiveArgs::Reader::Reader(LiveArgs& live) : state(live.state) {
+    slot = state->phase.load() & 1;
+    state->readers[slot]++;
+    snapshot = state->current.load();
+}
+
+
+LiveArgs::Reader::~Reader() {
+    state->readers[slot]--;
+}
+
+
+#ifdef __linux__
+
+
+// Watch the config file's directory rather than the file itself so we see
+// editors and deployment tools that replace the file by renaming over it.
+bool LiveArgs::watch() {
+    if (state->config_path == "" || state->watcher.joinable()) {
+        return false;
+    }
+
+    string path = state->config_path;
+    size_t slash = path.rfind('/');
+    string dir = slash == string::npos ? "." : path.substr(0, max(slash, size_t(1)));
+    string file = slash == string::npos ? path : path.substr(slash + 1);
+
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0 || pipe(state->stop_pipe) != 0) {
+        close(fd);
+        return false;
+    }
+
+    state->watcher = thread([this, fd, file]() {
+        vector<char> buffer(4096);
+        while (true) {
+            pollfd fds[2] = {{fd, POLLIN, 0}, {state->stop_pipe[0], POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            if (fds[1].revents != 0) {
+                break;
+            }
+
+            ssize_t n = read(fd, buffer.data(), buffer.size());
+            bool changed = false;
+            for (ssize_t i = 0; i < n; ) {
+                inotify_event* event = reinterpret_cast<inotify_event*>(&buffer[i]);
+                if (event->len > 0 && file == event->name) {
+                    changed = true;
+                }
+                i += sizeof(inotify_event) + event->len;
+            }
+            if (changed) {
+                reload();
+            }
+        }
+        close(fd);
+    });
+
+    return true;
+}
+
+
+#else
+
+
+bool LiveArgs::watch() {
+    return false;
+}
+
+
+#endif
+
+
+#endif // ARGS_LEAN
+
+
+// -----------------------------------------------------------------------------
+// ArgParser: utilities.
+// -----------------------------------------------------------------------------
+
+
+// Format a list of option values for the print() method.
+static string formatValues(vector<string> const& values) {
+    string result = "[";
+    for (size_t i = 0; i < values.size(); i++) {
+        if (i) result += ", ";
+        result += values[i];
+    }
+    return result + "]";
+}
+
+
+// Dump the parser's state to stdout.
+void ArgParser::print() {
+    string out = "Options:\n";
+    if (options.size() > 0) {
+        for (auto element: options) {
+            out += "  " + element.first + ": ";
+            Option *option = element.second;
+            out += "(" + option->fallback + ") ";
+            out += formatValues(option->values);
+            out += "\n";
+        }
+    } else {
+        out += "  [none]\n";
+    }
+
+    out += "\nFlags:\n";
+    if (flags.size() > 0) {
+        for (auto element: flags) {
+            out += "  " + element.first + ": " + to_string(element.second->count) + "\n";
+        }
+    } else {
+        out += "  [none]\n";
+    }
+
+    out += "\nArguments:\n";
+    if (args.size() > 0) {
+        for (auto arg: args) {
+            out += "  " + arg + "\n";
+        }
+    } else {
+        out += "  [none]\n";
+    }
+
+    out += "\nCommand:\n";
+    if (commandFound()) {
+        out += "  " + command_name + "\n";
+    } else {
+        out += "  [none]\n";
+    }
+
+    writeOutput(1, out);
+}
+
+
+// Print the parser's help text and exit.
+void ArgParser::exitHelp() {
+    writeOutput(1, helptext + "\n");
+    exit(0);
+}
+
+
+// Print the parser's version string and exit.
+void ArgParser::exitVersion() {
+    writeOutput(1, version + "\n");
+    exit(0);
+}
+
+
+// -----------------------------------------------------------------------------
+// ArgParser: cleanup.
+// -----------------------------------------------------------------------------
+
+
+// Delete each of the unique pointers in a map of aliases.
+template<typename T>
+static void deleteUnique(map<string, T*> const& aliases) {
+    vector<T*> pointers;
+    for (auto element: aliases) {
+        pointers.push_back(element.second);
+    }
+    sort(pointers.begin(), pointers.end());
+    pointers.erase(unique(pointers.begin(), pointers.end()), pointers.end());
+    for (auto pointer: pointers) {
+        delete pointer;
+    }
+}
+
+
+ArgParser::~ArgParser() {
+    delete constraints;
+    deleteUnique(options);
+    deleteUnique(flags);
+    deleteUnique(commands);
 }
@@ -9,7 +9,9 @@
 #ifndef args_h
 #define args_h
 
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -18,6 +20,11 @@ namespace args {
     struct ArgStream;
     struct Option;
     struct Flag;
+    struct BatchResult;
+    struct BatchConfig;
+    struct FreezeBuffer;
+    class FrozenArgs;
+    struct LiveState;
 
     class ArgParser {
         public:
@@ -36,12 +43,31 @@ namespace args {
             std::string version;
 
             // Callback function for command parsers.
-            void (*callback)(std::string cmd_name, ArgParser& cmd_parser);
+            void (*callback)(std::string cmd_name, ArgParser& cmd_parser) = nullptr;
+
+            // Partial parsing. If [ignore_unknown] is set, unrecognised flags
+            // and options are added to [rest] instead of causing an error. If
+            // [stop_at_positional] is set, the first positional argument or
+            // command and everything following it are added to [rest].
+            bool ignore_unknown = false;
+            bool stop_at_positional = false;
+
+            // Stores unrecognised and unparsed arguments in their original order.
+            std::vector<std::string> rest;
 
             // Register flags and options.
             void flag(std::string const& name);
             void option(std::string const& name, std::string const& fallback = "");
 
+            // Register constraints, checked automatically after parsing. The
+            // [names] parameters accept space-separated lists of flag and
+            // option names, which must already be registered.
+            void require(std::string const& names);
+            void exclusive(std::string const& names);
+            void depends(std::string const& name, std::string const& names);
+            void choices(std::string const& name, std::string const& values);
+            void range(std::string const& name, double min, double max);
+
             // Parse the application's command line arguments.
             void parse(int argc, char **argv);
             void parse(std::vector<std::string> args);
@@ -64,23 +90,212 @@ namespace args {
             std::string commandName();
             ArgParser& commandParser();
 
+            // Returns [rest] as a NULL-terminated array of pointers into the
+            // original argv, e.g. for passing to execv().
+            char** restArgv();
+
+            // Copy the parsed results into a compact, immutable block. Throws
+            // std::length_error if the block would exceed 4 GiB.
+            FrozenArgs freeze();
+
+            // Batch and server modes aren't available in ARGS_LEAN builds.
+#ifndef ARGS_LEAN
+            // Batch mode: parse a list of command invocations separated by a
+            // separator token and run their callbacks on a worker pool.
+            std::vector<BatchResult> parseBatch(
+                int argc,
+                char **argv,
+                BatchConfig const& config
+            );
+            std::vector<BatchResult> parseBatch(
+                std::vector<std::string> args,
+                BatchConfig const& config
+            );
+
+            // Resident server mode: listen on a Unix-domain socket and run
+            // each forwarded invocation against this parser. A stale socket
+            // at [socket_path] is replaced, but not any other file or the
+            // socket of a running server. Returns false if the socket cannot
+            // be set up or accepting connections fails; otherwise never
+            // returns.
+            bool serve(std::string const& socket_path);
+#endif
+
             // Print a parser instance to stdout.
             void print();
 
         private:
+            friend class LiveArgs;
+            friend struct LiveState;
+            struct Constraints;
+
             std::map<std::string, Option*> options;
             std::map<std::string, Flag*> flags;
             std::map<std::string, ArgParser*> commands;
             std::string command_name;
+            std::vector<std::string> slot_names;
+            Constraints* constraints = nullptr;
+            std::vector<size_t> rest_indices;
+            std::vector<char*> rest_argv;
+            char** rest_argv_ptr = nullptr;
 
             void parse(ArgStream& args);
+            ArgParser* clone(bool with_results = false);
+            uint32_t freeze(FreezeBuffer& buffer);
+            bool loadConfig(std::string const& path, std::string& error);
             void registerOption(std::string const& name, Option* option);
-            void parseLongOption(std::string arg, ArgStream& stream);
-            void parseShortOption(std::string arg, ArgStream& stream);
-            void parseEqualsOption(std::string prefix, std::string name, std::string value);
+            bool parseLongOption(std::string arg, ArgStream& stream);
+            bool parseShortOption(std::string arg, ArgStream& stream);
+            bool parseEqualsOption(std::string prefix, std::string name, std::string value);
+            void addRest(ArgStream& stream, size_t index);
+            void setRestArgv(ArgStream& stream);
+            int slotFor(std::string const& name, bool options_only = false);
+            Constraints& getConstraints();
+            std::string displayName(int slot);
+            bool checkConstraints(std::string& error);
+            void checkConstraintsOrExit();
             void exitHelp();
             void exitVersion();
     };
+
+    // Read-only view of a parser's results, created by ArgParser::freeze().
+    // Positional arguments, flag counts, option values, and the chain of
+    // found commands are packed into a single contiguous allocation which
+    // can be shared freely between threads and with forked children.
+    // Returned strings point into the block and live as long as any view.
+    class FrozenArgs {
+        public:
+            FrozenArgs();
+
+            // Retrieve flag and option values.
+            bool found(char const* name) const;
+            int count(char const* name) const;
+            char const* value(char const* name) const;
+            char const* value(char const* name, int index) const;
+
+            // Retrieve positional arguments.
+            int numArgs() const;
+            char const* arg(int index) const;
+
+            // Retrieve the found command, if any.
+            bool commandFound() const;
+            char const* commandName() const;
+            FrozenArgs commandArgs() const;
+
+        private:
+            friend class ArgParser;
+            struct Node;
+            struct Entry;
+
+            std::shared_ptr<char const> block;
+            uint32_t node;
+
+            FrozenArgs(std::shared_ptr<char const> block, uint32_t node);
+            Node const* getNode() const;
+            Entry const* find(char const* name) const;
+    };
+
+    // LiveArgs, forward(), and batch mode types aren't available in ARGS_LEAN
+    // builds, which must define ARGS_LEAN wherever this header is included.
+#ifndef ARGS_LEAN
+    // Reloadable option values for long-running processes. Publishes a
+    // FrozenArgs snapshot of a parser's results overlaid with the contents of
+    // a config file. Readers access the current snapshot without locking or
+    // waiting; a reload publishes a new snapshot and frees the old one once
+    // no reader can still be using it.
+    class LiveArgs {
+        public:
+            // The parser's current results are copied; the parser itself
+            // needn't outlive the LiveArgs instance. The initial snapshot
+            // holds the parser's results alone; call reload() to apply the
+            // config file.
+            LiveArgs(ArgParser& parser, std::string const& config_path = "");
+            ~LiveArgs();
+
+            LiveArgs(LiveArgs const&) = delete;
+            LiveArgs& operator=(LiveArgs const&) = delete;
+
+            // Rebuild the snapshot from the parser's results and the config
+            // file. On failure the current snapshot is kept, [error], if
+            // supplied, describes the problem, and [on_error] is called.
+            bool reload(std::string* error = nullptr);
+
+            // Reload automatically whenever the config file changes. Uses
+            // inotify; returns false if unsupported or the file can't be
+            // watched.
+            bool watch();
+
+            // Optional function called with the error message whenever a
+            // reload fails, including reloads triggered by watch(). Set it
+            // before calling watch() as it's called from the watcher thread.
+            void (*on_error)(std::string const& error) = nullptr;
+
+            // Retrieve a copy of an option value from the current snapshot.
+            std::string value(char const* name);
+
+            // Pins the current snapshot for the reader's lifetime. Readers
+            // should be short-lived as a reload waits for them to finish.
+            class Reader {
+                public:
+                    Reader(LiveArgs& live);
+                    ~Reader();
+
+                    Reader(Reader const&) = delete;
+                    Reader& operator=(Reader const&) = delete;
+
+                    FrozenArgs const& operator*() const { return *snapshot; }
+                    FrozenArgs const* operator->() const { return snapshot; }
+
+                private:
+                    LiveState* state;
+                    unsigned slot;
+                    FrozenArgs const* snapshot;
+            };
+
+        private:
+            LiveState* state;
+    };
+
+    // Thin client for ArgParser::serve(). Forwards the arguments, working
+    // directory, environment, and standard streams to the server and returns
+    // the invocation's exit status, or -1 if the server cannot be reached.
+    int forward(std::string const& socket_path, int argc, char **argv);
+
+    // Settings for ArgParser::parseBatch().
+    struct BatchConfig {
+        // Token separating command invocations.
+        std::string separator = "+";
+
+        // Maximum number of callbacks to run concurrently. Zero means one
+        // worker per hardware thread.
+        int max_workers = 0;
+
+        // If true, results are reported to [on_result] in argument order;
+        // otherwise they are reported as soon as each command completes.
+        // This orders [on_result] calls only: anything callbacks write to
+        // stdout or stderr directly can interleave across workers. Callbacks
+        // wanting ordered output should store it in their parser instance,
+        // e.g. in [args], and print it from [on_result].
+        bool ordered = true;
+
+        // Optional function called with each result as it is reported.
+        // Calls are serialized so the function needn't be thread-safe.
+        void (*on_result)(BatchResult& result) = nullptr;
+    };
+
+    // Result of a single command invocation in batch mode.
+    struct BatchResult {
+        // The command name as it appeared in the argument list.
+        std::string command;
+
+        // The command's parser instance for this invocation.
+        std::shared_ptr<ArgParser> parser;
+
+        // False if the command's callback threw an exception.
+        bool ok = true;
+        std::string error;
+    };
+#endif
 }
 
 #endif
@@ -0,0 +1,41 @@
+#include <iostream>
+#include <string>
+#include "args.h"
+
+using namespace args;
+using namespace std;
+
+// Run `ex3 serve` to start the server. Other invocations are forwarded to
+// the server if it's running, otherwise they're handled locally.
+static const string socket_path = "/tmp/argspp-example3.sock";
+
+void callback(string cmd_name, ArgParser& cmd_parser) {
+    cout << "---------- boo! ----------\n";
+    cmd_parser.print();
+    cout << "--------------------------\n\n";
+}
+
+int main(int argc, char **argv) {
+    bool is_server = argc == 2 && string(argv[1]) == "serve";
+
+    if (!is_server) {
+        int status = forward(socket_path, argc, argv);
+        if (status >= 0) {
+            return status;
+        }
+    }
+
+    ArgParser parser("Usage: example...", "1.0");
+
+    ArgParser& cmd_parser = parser.command("boo", "Usage: example boo...", callback);
+    cmd_parser.flag("foo f");
+    cmd_parser.option("bar b", "default");
+
+    if (is_server) {
+        parser.serve(socket_path);
+        cerr << "Error: cannot listen on " << socket_path << ".\n";
+        return 1;
+    }
+
+    parser.parse(argc, argv);
+}
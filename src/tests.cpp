@@ -2,11 +2,23 @@
 // Unit test suite.
 // -----------------------------------------------------------------------------
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 #include <string>
 #include "args.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+    #include <signal.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
 using namespace std;
 using namespace args;
 
@@ -164,6 +176,528 @@ void test_command() {
     printf(".");
 }
 
+#ifndef ARGS_LEAN
+
+// -----------------------------------------------------------------------------
+// 8. Batch mode.
+// -----------------------------------------------------------------------------
+
+void batch_callback(string cmd_name, ArgParser& cmd_parser) {
+    if (cmd_parser.found("fail")) {
+        throw runtime_error("failed");
+    }
+}
+
+vector<string> batch_reported;
+
+void batch_on_result(BatchResult& result) {
+    batch_reported.push_back(result.parser->args[0]);
+}
+
+void test_batch() {
+    ArgParser parser;
+    ArgParser& cmd_parser = parser.command("boo", "", batch_callback);
+    cmd_parser.flag("fail");
+    cmd_parser.option("bar", "default");
+    BatchConfig config;
+    config.max_workers = 4;
+    config.on_result = batch_on_result;
+    vector<BatchResult> results = parser.parseBatch(vector<string>({
+        "boo", "1", "--bar", "baz", "+", "boo", "2", "--fail", "+", "+", "boo", "3"
+    }), config);
+    assert(results.size() == 3);
+    assert(results[0].ok && results[0].parser->value("bar") == "baz");
+    assert(!results[1].ok && results[1].error == "failed");
+    assert(results[2].ok && results[2].parser->value("bar") == "default");
+    assert(batch_reported == vector<string>({"1", "2", "3"}));
+    assert(cmd_parser.args.size() == 0);
+    printf(".");
+}
+
+void test_batch_unordered() {
+    batch_reported.clear();
+    ArgParser parser;
+    ArgParser& cmd_parser = parser.command("boo", "", batch_callback);
+    cmd_parser.flag("fail");
+    BatchConfig config;
+    config.ordered = false;
+    config.on_result = batch_on_result;
+    vector<BatchResult> results = parser.parseBatch(vector<string>({
+        "boo", "1", "+", "boo", "2", "+", "boo", "3", "+", "boo", "4"
+    }), config);
+    assert(results.size() == 4);
+    sort(batch_reported.begin(), batch_reported.end());
+    assert(batch_reported == vector<string>({"1", "2", "3", "4"}));
+    printf(".");
+}
+
+vector<string> batch_called;
+
+void batch_record_callback(string cmd_name, ArgParser& cmd_parser) {
+    batch_called.push_back(cmd_name);
+}
+
+void test_batch_nested() {
+    ArgParser parser;
+    ArgParser& cmd_parser = parser.command("boo", "", batch_record_callback);
+    cmd_parser.command("sub", "", batch_record_callback);
+    BatchConfig config;
+    config.max_workers = 1;
+    vector<BatchResult> results = parser.parseBatch(vector<string>({"boo", "sub"}), config);
+    assert(results.size() == 1);
+    assert(results[0].parser->commandName() == "sub");
+    assert(batch_called == vector<string>({"sub", "boo"}));
+    printf(".");
+}
+
+// -----------------------------------------------------------------------------
+// 9. Server mode.
+// -----------------------------------------------------------------------------
+
+void server_callback(string cmd_name, ArgParser& cmd_parser) {
+#if defined(__unix__) || defined(__APPLE__)
+    char cwd[4096];
+    char const* env = getenv("ARGSPP_TEST");
+    if (env != nullptr) {
+        printf("cwd=%s env=%s\n", getcwd(cwd, sizeof(cwd)), env);
+        fprintf(stderr, "err\n");
+    }
+#endif
+    exit(cmd_parser.count("foo") + cmd_parser.args.size());
+}
+
+string read_file(string const& path) {
+    string text;
+    FILE* file = fopen(path.c_str(), "r");
+    char buffer[256];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, n);
+    }
+    fclose(file);
+    return text;
+}
+
+void test_server() {
+#if defined(__unix__) || defined(__APPLE__)
+    string path = "/tmp/argspp-test-" + to_string(getpid()) + ".sock";
+
+    // Refuse to replace a file that isn't a socket.
+    FILE* file = fopen(path.c_str(), "w");
+    fclose(file);
+    ArgParser other;
+    assert(!other.serve(path));
+    unlink(path.c_str());
+
+    // The server parses its own arguments before serving; forwarded
+    // invocations must not see the results.
+    pid_t server = fork();
+    if (server == 0) {
+        ArgParser parser;
+        parser.flag("verbose");
+        ArgParser& cmd_parser = parser.command("boo");
+        cmd_parser.flag("foo f");
+        parser.parse(vector<string>({"--verbose", "boo", "-f", "stale"}));
+        cmd_parser.callback = server_callback;
+        parser.serve(path);
+        _exit(1);
+    }
+
+    char const* argv[] = {"client", "boo", "-fff", "abc", nullptr};
+    int status = -1;
+    for (int i = 0; i < 100 && status == -1; i++) {
+        status = forward(path, 4, const_cast<char**>(argv));
+        if (status == -1) {
+            usleep(10000);
+        }
+    }
+    assert(status == 4);
+    char const* bare_argv[] = {"client", "boo", nullptr};
+    assert(forward(path, 2, const_cast<char**>(bare_argv)) == 0);
+
+    // Refuse to replace the socket of a running server.
+    assert(!other.serve(path));
+
+    // Check the client's stdout, stderr, working directory, and environment
+    // reach the callback.
+    string out_path = path + ".out";
+    string err_path = path + ".err";
+    char old_cwd[4096];
+    assert(getcwd(old_cwd, sizeof(old_cwd)) != nullptr);
+    assert(chdir("/") == 0);
+    setenv("ARGSPP_TEST", "hello", 1);
+    fflush(stdout);
+    int saved_stdout = dup(1);
+    int saved_stderr = dup(2);
+    FILE* out = fopen(out_path.c_str(), "w");
+    FILE* err = fopen(err_path.c_str(), "w");
+    dup2(fileno(out), 1);
+    dup2(fileno(err), 2);
+    status = forward(path, 4, const_cast<char**>(argv));
+    dup2(saved_stdout, 1);
+    dup2(saved_stderr, 2);
+    close(saved_stdout);
+    close(saved_stderr);
+    fclose(out);
+    fclose(err);
+    unsetenv("ARGSPP_TEST");
+    assert(chdir(old_cwd) == 0);
+    assert(status == 4);
+    assert(read_file(out_path) == "cwd=/ env=hello\n");
+    assert(read_file(err_path) == "err\n");
+    unlink(out_path.c_str());
+    unlink(err_path.c_str());
+
+    kill(server, SIGTERM);
+    waitpid(server, nullptr, 0);
+    unlink(path.c_str());
+    assert(forward(path, 4, const_cast<char**>(argv)) == -1);
+#endif
+    printf(".");
+}
+
+#endif // ARGS_LEAN
+
+// -----------------------------------------------------------------------------
+// 10. Frozen results.
+// -----------------------------------------------------------------------------
+
+void test_freeze() {
+    ArgParser parser;
+    parser.flag("foo f");
+    parser.option("bar b", "default");
+    parser.option("baz", "fallback");
+    ArgParser& cmd_parser = parser.command("boo");
+    cmd_parser.option("qux q");
+    parser.parse(vector<string>({"-ff", "--bar", "x", "-b", "y", "boo", "def", "-q", "z"}));
+    FrozenArgs frozen = parser.freeze();
+    assert(frozen.found("foo") && frozen.count("f") == 2);
+    assert(frozen.count("bar") == 2);
+    assert(string(frozen.value("b")) == "y");
+    assert(string(frozen.value("bar", 0)) == "x");
+    assert(frozen.value("bar", 2) == nullptr);
+    assert(string(frozen.value("baz")) == "fallback");
+    assert(!frozen.found("nope") && string(frozen.value("nope")) == "");
+    assert(frozen.numArgs() == 0 && frozen.arg(0) == nullptr);
+    assert(frozen.commandFound() && string(frozen.commandName()) == "boo");
+    FrozenArgs cmd_frozen = frozen.commandArgs();
+    assert(string(cmd_frozen.value("qux")) == "z");
+    assert(cmd_frozen.numArgs() == 1 && string(cmd_frozen.arg(0)) == "def");
+    assert(!cmd_frozen.commandFound());
+    printf(".");
+}
+
+// -----------------------------------------------------------------------------
+// 11. Partial parsing.
+// -----------------------------------------------------------------------------
+
+void test_ignore_unknown() {
+    ArgParser parser;
+    parser.ignore_unknown = true;
+    parser.flag("foo f");
+    parser.option("bar b");
+    char const* argv[] = {
+        "app", "--xyz", "-f", "abc", "-fq", "--bar=1", "--qux=2", "-b", "3", nullptr
+    };
+    parser.parse(9, const_cast<char**>(argv));
+    assert(parser.count("foo") == 1);
+    assert(parser.values("bar") == vector<string>({"1", "3"}));
+    assert(parser.args == vector<string>({"abc"}));
+    assert(parser.rest == vector<string>({"--xyz", "-fq", "--qux=2"}));
+    char** rest = parser.restArgv();
+    assert(rest[0] == argv[1] && rest[1] == argv[4] && rest[2] == argv[6]);
+    assert(rest[3] == nullptr);
+    printf(".");
+}
+
+void test_stop_at_positional() {
+    ArgParser parser;
+    parser.stop_at_positional = true;
+    parser.flag("foo f");
+    parser.command("boo");
+    char const* argv[] = {"app", "-f", "boo", "-x", "--foo", nullptr};
+    parser.parse(5, const_cast<char**>(argv));
+    assert(parser.count("foo") == 1);
+    assert(!parser.commandFound());
+    assert(parser.rest == vector<string>({"boo", "-x", "--foo"}));
+    assert(parser.restArgv() == const_cast<char**>(argv) + 2);
+    printf(".");
+}
+
+#ifndef ARGS_LEAN
+
+// -----------------------------------------------------------------------------
+// 12. Live reloading.
+// -----------------------------------------------------------------------------
+
+// Returns a temporary file path unique to this process.
+string temp_path(string const& suffix) {
+#if defined(__unix__) || defined(__APPLE__)
+    return "/tmp/argspp-test-" + to_string(getpid()) + suffix;
+#else
+    return "argspp-test" + suffix;
+#endif
+}
+
+void write_file(string const& path, string const& text) {
+    FILE* file = fopen(path.c_str(), "w");
+    fputs(text.c_str(), file);
+    fclose(file);
+}
+
+void test_live_reload() {
+    string path = temp_path(".conf");
+    write_file(path, "# comment\nbar = abc\n\nfoo = 2\n");
+
+    ArgParser parser;
+    parser.flag("foo f");
+    parser.option("bar b", "default");
+    parser.option("baz", "default");
+    parser.parse(vector<string>({"--baz", "xyz"}));
+
+    LiveArgs live(parser, path);
+    assert(live.value("bar") == "default");
+    assert(live.reload());
+    {
+        LiveArgs::Reader reader(live);
+        assert(string(reader->value("bar")) == "abc");
+        assert(string(reader->value("baz")) == "xyz");
+        assert(reader->count("foo") == 2);
+    }
+
+    write_file(path, "nope = 1\n");
+    string error;
+    assert(!live.reload(&error));
+    assert(error == path + ":1: 'nope' is not a recognised flag or option");
+    assert(live.value("bar") == "abc");
+
+    write_file(path, "bar = def\n");
+    assert(live.reload());
+    assert(live.value("bar") == "def");
+    assert(live.value("baz") == "xyz");
+
+    remove(path.c_str());
+    printf(".");
+}
+
+atomic<int> live_error_count(0);
+string live_error;
+
+void live_on_error(string const& error) {
+    live_error = error;
+    live_error_count++;
+}
+
+// Returns true if [condition] becomes true within two seconds.
+template<typename F>
+bool wait_for(F condition) {
+    for (int i = 0; i < 200; i++) {
+        if (condition()) {
+            return true;
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    return false;
+}
+
+void test_live_watch() {
+#ifdef __linux__
+    string path = temp_path(".conf");
+    write_file(path, "bar = abc\n");
+
+    ArgParser parser;
+    parser.option("bar b", "default");
+
+    LiveArgs live(parser, path);
+    live.on_error = live_on_error;
+    assert(live.reload());
+    assert(live.watch());
+
+    write_file(path, "bar = def\n");
+    assert(wait_for([&]() { return live.value("bar") == "def"; }));
+
+    // Replace the file by renaming over it, as editors do.
+    write_file(path + ".tmp", "bar = ghi\n");
+    rename((path + ".tmp").c_str(), path.c_str());
+    assert(wait_for([&]() { return live.value("bar") == "ghi"; }));
+
+    write_file(path, "nope = 1\n");
+    assert(wait_for([&]() { return live_error_count.load() > 0; }));
+    assert(live_error == path + ":1: 'nope' is not a recognised flag or option");
+    assert(live.value("bar") == "ghi");
+
+    remove(path.c_str());
+#endif
+    printf(".");
+}
+
+void test_live_concurrent_readers() {
+    string path = temp_path(".conf");
+    write_file(path, "bar = 0\nfoo = 0\n");
+
+    ArgParser parser;
+    parser.flag("foo");
+    parser.option("bar");
+
+    LiveArgs live(parser, path);
+    assert(live.reload());
+
+    // Each snapshot pairs bar = N with foo = N; readers must never see a mix.
+    atomic<bool> stop(false);
+    atomic<bool> consistent(true);
+    vector<thread> readers;
+    for (int i = 0; i < 4; i++) {
+        readers.emplace_back([&]() {
+            while (!stop) {
+                LiveArgs::Reader reader(live);
+                if (to_string(reader->count("foo")) != reader->value("bar")) {
+                    consistent = false;
+                }
+            }
+        });
+    }
+
+    for (int i = 1; i <= 200; i++) {
+        write_file(path, "bar = " + to_string(i) + "\nfoo = " + to_string(i) + "\n");
+        assert(live.reload());
+    }
+
+    stop = true;
+    for (auto& reader: readers) {
+        reader.join();
+    }
+    assert(consistent);
+    assert(live.value("bar") == "200");
+
+    remove(path.c_str());
+    printf(".");
+}
+
+#endif // ARGS_LEAN
+
+// -----------------------------------------------------------------------------
+// 13. Constraints.
+// -----------------------------------------------------------------------------
+
+void setup_constraints(ArgParser& parser) {
+    parser.flag("foo f");
+    parser.flag("bar b");
+    parser.option("baz z");
+    parser.option("qux q", "1");
+    parser.option("out o");
+    parser.require("out");
+    parser.exclusive("foo bar");
+    parser.depends("baz", "foo");
+    parser.choices("baz", "abc def");
+    parser.range("qux", 1, 10);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+// Returns the exit status of a child process which sets up a parser and parses
+// the arguments. The status is zero if parsing returns normally.
+int parse_status(void (*setup)(ArgParser&), vector<string> args) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        freopen("/dev/null", "w", stderr);
+        ArgParser parser;
+        setup(parser);
+        parser.parse(args);
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+#endif
+
+void test_constraints() {
+    ArgParser parser;
+    setup_constraints(parser);
+    parser.parse(vector<string>({"-o", "x", "-f", "--baz", "def", "-q", "2.5"}));
+    assert(parser.value("baz") == "def");
+#if defined(__unix__) || defined(__APPLE__)
+    assert(parse_status(setup_constraints, {}) == 1);
+    assert(parse_status(setup_constraints, {"-o", "x", "-fb"}) == 1);
+    assert(parse_status(setup_constraints, {"-o", "x", "-b", "-z", "abc"}) == 1);
+    assert(parse_status(setup_constraints, {"-o", "x", "-f", "-z", "xyz"}) == 1);
+    assert(parse_status(setup_constraints, {"-o", "x", "-q", "11"}) == 1);
+    assert(parse_status(setup_constraints, {"-o", "x", "-q", "1x"}) == 1);
+    assert(parse_status(setup_constraints, {"-o", "x", "-q", "nan"}) == 1);
+    assert(parse_status(setup_constraints, {"--out=x", "-fz", "abc", "-q", "10"}) == 0);
+#endif
+    printf(".");
+}
+
+void setup_many_slots(ArgParser& parser) {
+    for (int i = 0; i < 200; i++) {
+        parser.flag("f" + to_string(i));
+    }
+    parser.require("f150");
+    parser.exclusive("f3 f130 f199");
+    parser.depends("f70", "f0 f140");
+}
+
+void test_constraints_many_slots() {
+    ArgParser parser;
+    setup_many_slots(parser);
+    parser.parse(vector<string>({"--f150", "--f130", "--f70", "--f0", "--f140"}));
+    assert(parser.found("f150"));
+#if defined(__unix__) || defined(__APPLE__)
+    assert(parse_status(setup_many_slots, {"--f130"}) == 1);
+    assert(parse_status(setup_many_slots, {"--f150", "--f130", "--f199"}) == 1);
+    assert(parse_status(setup_many_slots, {"--f150", "--f3", "--f199"}) == 1);
+    assert(parse_status(setup_many_slots, {"--f150", "--f70", "--f0"}) == 1);
+    assert(parse_status(setup_many_slots, {"--f150", "--f70", "--f140"}) == 1);
+#endif
+    printf(".");
+}
+
+void constraints_callback(string cmd_name, ArgParser& cmd_parser) {
+    _exit(3);
+}
+
+void setup_constraints_command(ArgParser& parser) {
+    parser.option("out o");
+    parser.require("out");
+    parser.command("boo", "", constraints_callback);
+}
+
+void test_constraints_before_callback() {
+#if defined(__unix__) || defined(__APPLE__)
+    assert(parse_status(setup_constraints_command, {"boo"}) == 1);
+    assert(parse_status(setup_constraints_command, {"-o", "x", "boo"}) == 3);
+#endif
+    printf(".");
+}
+
+#ifndef ARGS_LEAN
+void test_constraints_live_reload() {
+    string path = temp_path(".conf");
+    write_file(path, "baz = abc\n");
+
+    ArgParser parser;
+    setup_constraints(parser);
+    parser.parse(vector<string>({"-o", "x", "-f"}));
+
+    LiveArgs live(parser, path);
+    assert(live.reload());
+    assert(live.value("baz") == "abc");
+
+    write_file(path, "baz = xyz\n");
+    string error;
+    assert(!live.reload(&error));
+    assert(error == path + ": invalid value 'xyz' for --baz. Valid choices are: abc, def.");
+    assert(live.value("baz") == "abc");
+
+    write_file(path, "qux = 20\n");
+    assert(!live.reload(&error));
+    assert(live.value("qux") == "1");
+
+    remove(path.c_str());
+    printf(".");
+}
+#endif
+
 // -----------------------------------------------------------------------------
 // Test runner.
 // -----------------------------------------------------------------------------
@@ -203,6 +737,38 @@ int main() {
     printf(" 5 ");
     test_command();
 
+#ifndef ARGS_LEAN
+    printf(" 8 ");
+    test_batch();
+    test_batch_unordered();
+    test_batch_nested();
+
+    printf(" 9 ");
+    test_server();
+#endif
+
+    printf(" 10 ");
+    test_freeze();
+
+    printf(" 11 ");
+    test_ignore_unknown();
+    test_stop_at_positional();
+
+#ifndef ARGS_LEAN
+    printf(" 12 ");
+    test_live_reload();
+    test_live_watch();
+    test_live_concurrent_readers();
+#endif
+
+    printf(" 13 ");
+    test_constraints();
+    test_constraints_many_slots();
+    test_constraints_before_callback();
+#ifndef ARGS_LEAN
+    test_constraints_live_reload();
+#endif
+
     printf(" [ok]\n");
     line();
 }